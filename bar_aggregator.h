@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+class Bar_aggregator {
+ public:
+  Bar_aggregator(const std::string& prefix,
+                 const std::vector<unsigned long>& intervals_ms,
+                 unsigned long lateness_ms = 0) {
+    for (auto v : intervals_ms)
+      series.emplace_back(prefix + "_" + std::to_string(v) + "ms", v,
+                          lateness_ms);
+  }
+
+  template <class Book>
+  void on_update(const Book& l) {
+    if (series.empty()) return;
+
+    auto [ask_price, ask_amount] = l.get_best_ask();
+    auto [bid_price, bid_amount] = l.get_best_bid();
+    Quote quote{l.get_time(), bid_price, bid_amount, ask_price, ask_amount};
+
+    for (auto& v : series) v.add(quote);
+  }
+
+  // Closes bars whose interval ended more than the lateness allowance
+  // before now_ms and writes every completed bar, so a live run does not
+  // hold them until a block fills.
+  void on_timer(unsigned long now_ms) {
+    for (auto& v : series) v.on_timer(now_ms);
+  }
+
+  void flush() {
+    for (auto& v : series) v.flush();
+  }
+
+ private:
+  struct Quote {
+    unsigned long time;
+    double bid_price;
+    int bid_amount;
+    double ask_price;
+    int ask_amount;
+  };
+
+  class Series {
+   public:
+    Series(std::string dir, unsigned long interval, unsigned long lateness)
+        : dir(std::move(dir)),
+          interval(std::max(1ul, interval)),
+          lateness(lateness) {}
+
+    void add(const Quote& q) {
+      uint64_t start = q.time - q.time % interval;
+
+      // A quote whose bar was already written or passed by a later one is
+      // counted in the late column of the next bar written, so start_ms
+      // stays strictly increasing and no quote goes unaccounted for.
+      if (start < (has_bar ? bar.start : closed_until)) {
+        ++late;
+        return;
+      }
+
+      if (has_bar && start != bar.start) close_bar();
+
+      if (!has_bar) {
+        bar = Bar{};
+        bar.start = start;
+        has_bar = true;
+      }
+
+      ++bar.updates;
+      if (q.bid_price == 0 || q.ask_price == 0) return;
+
+      double mid = (q.bid_price + q.ask_price) / 2;
+      double spread = q.ask_price - q.bid_price;
+      int depth = q.bid_amount + q.ask_amount;
+      double imbalance = depth != 0 ? double(q.bid_amount) / depth : 0.5;
+
+      if (bar.quotes == 0) {
+        bar.open = bar.high = bar.low = mid;
+        bar.spread_min = bar.spread_max = spread;
+      }
+
+      bar.high = std::max(bar.high, mid);
+      bar.low = std::min(bar.low, mid);
+      bar.close = mid;
+      bar.spread_min = std::min(bar.spread_min, spread);
+      bar.spread_max = std::max(bar.spread_max, spread);
+      bar.spread_sum += spread;
+      bar.imbalance_sum += imbalance;
+      bar.imbalance_close = imbalance;
+      ++bar.quotes;
+    }
+
+    void on_timer(unsigned long now_ms) {
+      if (has_bar && now_ms > bar.start + interval + lateness) close_bar();
+      write_columns();
+    }
+
+    void flush() {
+      // Late quotes seen after the last bar closed get an empty bar.
+      if (!has_bar && late != 0) {
+        bar = Bar{};
+        bar.start = closed_until;
+        has_bar = true;
+      }
+
+      if (has_bar) close_bar();
+      write_columns();
+    }
+
+   private:
+    struct Bar {
+      uint64_t start = 0;
+      uint64_t updates = 0;
+      uint64_t quotes = 0;
+      double open = 0;
+      double high = 0;
+      double low = 0;
+      double close = 0;
+      double spread_min = 0;
+      double spread_max = 0;
+      double spread_sum = 0;
+      double imbalance_sum = 0;
+      double imbalance_close = 0;
+    };
+
+    static constexpr size_t block_size = 4096;
+
+    void close_bar() {
+      const double nan = std::numeric_limits<double>::quiet_NaN();
+      bool quoted = bar.quotes != 0;
+
+      start_ms.push_back(bar.start);
+      updates.push_back(bar.updates);
+      late_quotes.push_back(late);
+      open.push_back(quoted ? bar.open : nan);
+      high.push_back(quoted ? bar.high : nan);
+      low.push_back(quoted ? bar.low : nan);
+      close.push_back(quoted ? bar.close : nan);
+      spread_min.push_back(quoted ? bar.spread_min : nan);
+      spread_max.push_back(quoted ? bar.spread_max : nan);
+      spread_mean.push_back(quoted ? bar.spread_sum / bar.quotes : nan);
+      imbalance_mean.push_back(quoted ? bar.imbalance_sum / bar.quotes : nan);
+      imbalance_close.push_back(quoted ? bar.imbalance_close : nan);
+
+      late = 0;
+      has_bar = false;
+      closed_until = bar.start + interval;
+      if (start_ms.size() >= block_size) write_columns();
+    }
+
+    template <class T>
+    void write_column(const std::string& name, std::vector<T>& column) {
+      auto mode = written ? std::ios::app : std::ios::trunc;
+      std::ofstream out(dir + "/" + name, std::ios::binary | mode);
+      out.write(reinterpret_cast<const char*>(column.data()),
+                column.size() * sizeof(T));
+      column.clear();
+    }
+
+    void write_columns() {
+      if (start_ms.empty()) return;
+
+      std::filesystem::create_directories(dir);
+
+      write_column("start_ms.u64", start_ms);
+      write_column("updates.u64", updates);
+      write_column("late.u64", late_quotes);
+      write_column("open.f64", open);
+      write_column("high.f64", high);
+      write_column("low.f64", low);
+      write_column("close.f64", close);
+      write_column("spread_min.f64", spread_min);
+      write_column("spread_max.f64", spread_max);
+      write_column("spread_mean.f64", spread_mean);
+      write_column("imbalance_mean.f64", imbalance_mean);
+      write_column("imbalance_close.f64", imbalance_close);
+      written = true;
+    }
+
+    std::string dir;
+    unsigned long interval;
+    unsigned long lateness;
+    Bar bar;
+    bool has_bar = false;
+    uint64_t closed_until = 0;
+    uint64_t late = 0;
+    bool written = false;
+
+    std::vector<uint64_t> start_ms;
+    std::vector<uint64_t> updates;
+    std::vector<uint64_t> late_quotes;
+    std::vector<double> open;
+    std::vector<double> high;
+    std::vector<double> low;
+    std::vector<double> close;
+    std::vector<double> spread_min;
+    std::vector<double> spread_max;
+    std::vector<double> spread_mean;
+    std::vector<double> imbalance_mean;
+    std::vector<double> imbalance_close;
+  };
+
+  std::vector<Series> series;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <iomanip>
+#include <ostream>
+
+class Bbo_emitter {
+ public:
+  Bbo_emitter(std::ostream& output, bool changes_only,
+              unsigned long conflate_ms, unsigned long grace_ms = 0)
+      : output(output),
+        changes_only(changes_only),
+        conflate_ms(conflate_ms),
+        grace_ms(grace_ms) {}
+
+  template <class Book>
+  void on_update(const Book& l, bool changed) {
+    if (changes_only && !changed) return;
+    if (!l.has_bbo()) return;
+
+    auto [ask_price, ask_amount] = l.get_best_ask();
+    auto [bid_price, bid_amount] = l.get_best_bid();
+    Bbo bbo{l.get_time(), bid_price, bid_amount, ask_price, ask_amount};
+
+    if (conflate_ms == 0) {
+      write(bbo);
+      return;
+    }
+
+    // Each bucket is written at most once. An update for a bucket that was
+    // already written is dropped; the next record carries the book forward.
+    // One older than the pending bucket is folded into it.
+    unsigned long bucket = bbo.time / conflate_ms;
+    if (has_written && bucket <= written_bucket) return;
+    if (has_pending && bucket < pending_bucket) bucket = pending_bucket;
+    if (has_pending && bucket != pending_bucket) write_pending();
+
+    pending = bbo;
+    pending_bucket = bucket;
+    has_pending = true;
+  }
+
+  // Writes the pending record once the wall clock is past its bucket by
+  // more than the grace period, so feed delay and an exchange clock ahead
+  // of ours do not close the bucket early.
+  void on_timer(unsigned long now_ms) {
+    if (has_pending && now_ms > (pending_bucket + 1) * conflate_ms + grace_ms)
+      write_pending();
+  }
+
+  void flush() {
+    if (has_pending) write_pending();
+  }
+
+  size_t get_written() const { return written; }
+
+ private:
+  struct Bbo {
+    unsigned long time;
+    double bid_price;
+    int bid_amount;
+    double ask_price;
+    int ask_amount;
+  };
+
+  void write(const Bbo& v) {
+    output << std::fixed << std::setprecision(2) << "{" << v.time << "}, {"
+           << v.bid_price << "}, {" << v.bid_amount << "}, {" << v.ask_price
+           << "}, {" << v.ask_amount << "}" << std::endl;
+    has_pending = false;
+    ++written;
+  }
+
+  void write_pending() {
+    write(pending);
+    written_bucket = pending_bucket;
+    has_written = true;
+  }
+
+  std::ostream& output;
+  bool changes_only;
+  unsigned long conflate_ms;
+  unsigned long grace_ms;
+  Bbo pending{};
+  unsigned long pending_bucket = 0;
+  bool has_pending = false;
+  unsigned long written_bucket = 0;
+  bool has_written = false;
+  size_t written = 0;
+};
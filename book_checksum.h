@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#if defined(__x86_64__) && !defined(__SSE4_2__)
+__attribute__((target("sse4.2"))) inline uint32_t crc32c_u64_sse42(
+    uint32_t crc, uint64_t v) {
+  return uint32_t(_mm_crc32_u64(crc, v));
+}
+#endif
+
+// Uses the CRC32C instruction when compiled for it; a default x86-64
+// build checks for SSE4.2 at run time before falling back to the table.
+inline uint32_t crc32c_u64(uint32_t crc, uint64_t v) {
+#if defined(__SSE4_2__)
+  return uint32_t(_mm_crc32_u64(crc, v));
+#elif defined(__ARM_FEATURE_CRC32)
+  return __crc32cd(crc, v);
+#else
+#if defined(__x86_64__)
+  static const bool sse42 = __builtin_cpu_supports("sse4.2");
+  if (sse42) return crc32c_u64_sse42(crc, v);
+#endif
+
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82F63B78 & (0 - (c & 1)));
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  for (int i = 0; i < 8; ++i)
+    crc = table[(crc ^ (v >> (i * 8))) & 0xFF] ^ (crc >> 8);
+  return crc;
+#endif
+}
+
+inline uint32_t crc32c_level(uint32_t crc, double price, int amount) {
+  uint64_t bits;
+  std::memcpy(&bits, &price, sizeof(bits));
+
+  crc = crc32c_u64(crc, bits);
+  return crc32c_u64(crc, uint64_t(uint32_t(amount)));
+}
+
+template <class Bid_it, class Ask_it>
+uint32_t top_levels_checksum(Bid_it bid, Bid_it bid_end, Ask_it ask,
+                             Ask_it ask_end, size_t levels) {
+  uint32_t crc = ~uint32_t(0);
+
+  for (size_t i = 0; i < levels && (bid != bid_end || ask != ask_end); ++i) {
+    if (bid != bid_end) {
+      crc = crc32c_level(crc, bid->first, bid->second);
+      ++bid;
+    }
+    if (ask != ask_end) {
+      crc = crc32c_level(crc, ask->first, ask->second);
+      ++ask;
+    }
+  }
+
+  return ~crc;
+}
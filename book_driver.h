@@ -0,0 +1,457 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bar_aggregator.h"
+#include "bbo_emitter.h"
+#include "latency_monitor.h"
+#include "perf_counters.h"
+#include "processed_data.h"
+#include "uring_ingest.h"
+#include "websocket.h"
+
+struct Options {
+  std::vector<std::string> subs;
+  bool busy_poll = false;
+  bool changes_only = false;
+  unsigned long conflate_ms = 0;
+  size_t top_levels = 1;
+  unsigned long stale_ms = 1000;
+  // Levels kept per side, 0 for all. Must be at least the subscription
+  // depth: the feed never re-sends levels the cap dropped, so a smaller
+  // cap leaves the book incomplete once the levels above them are removed.
+  size_t depth = 0;
+  std::map<std::string, size_t> channel_depth;
+  unsigned queue_depth = 32;
+  size_t buffer_kb = 1024;
+  unsigned workers = 0;
+  size_t checksum_levels = 0;
+  std::vector<unsigned long> bar_intervals;
+
+  size_t get_depth(const std::string& channel) const {
+    auto it = channel_depth.find(channel);
+    return it != channel_depth.end() ? it->second : depth;
+  }
+};
+
+template <class Book>
+int run_live(const std::string& url, const std::string& output_path,
+             std::ofstream& output, const Options& options,
+             Perf_counters& perf) {
+  Ws_client client;
+
+  if (auto err = client.connect(url, options.busy_poll); !err.empty()) {
+    std::cerr << "error: " << err << std::endl;
+    return 1;
+  }
+
+  auto subscribe = [&](const std::string& v) {
+    client.send_text("{\"sub\":\"" + v +
+                     "\",\"data_type\":\"incremental\",\"id\":\"" + v +
+                     "\"}");
+  };
+
+  for (const auto& v : options.subs) subscribe(v);
+
+  std::signal(SIGINT, [](int) { ws_stop_requested = 1; });
+
+  struct Channel {
+    Book book;
+    Bbo_emitter emitter;
+    Latency_monitor latency;
+    Bar_aggregator bars;
+    bool synced = false;
+  };
+
+  std::map<std::string, Channel> channels;
+  size_t mismatches = 0;
+  std::chrono::duration<double, std::nano> summ_wire_to_bbo_time{};
+  size_t update_counter = 0;
+
+  auto wall_ms = [] {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  };
+
+  auto check_stale = [&](const std::string& ch, Channel& v,
+                         Ws_client::clock::time_point now) {
+    if (!v.latency.poll_stale(now)) return;
+
+    // Transitions go to stdout, not the BBO stream; the flag itself stays
+    // queryable as latency.get_stale() next to the channel's book.
+    std::cout << ch << (v.latency.get_stale() ? ": stale" : ": live")
+              << " at " << wall_ms() << " ms" << std::endl;
+  };
+
+  auto on_message = [&](const std::string& msg,
+                        Ws_client::clock::time_point recv_time) {
+    perf.start();
+    Processed_data ev = Processed_data(msg);
+    perf.stop(Perf_phase::parse);
+
+    if (ev.event == Event_type::ping) {
+      client.send_text("{\"pong\":" + std::to_string(ev.time) + "}");
+      return;
+    }
+
+    auto it = channels.find(ev.channel);
+    bool changed = true;
+
+    perf.start();
+
+    if (ev.event == Event_type::snapshot) {
+      if (it == channels.end()) {
+        Channel channel{
+            Book(options.top_levels, options.get_depth(ev.channel),
+                 options.checksum_levels),
+            Bbo_emitter(output, options.changes_only, options.conflate_ms,
+                        options.stale_ms),
+            Latency_monitor(std::chrono::milliseconds(options.stale_ms)),
+            Bar_aggregator(output_path + "." + ev.channel,
+                           options.bar_intervals, options.stale_ms)};
+        it = channels.try_emplace(ev.channel, std::move(channel)).first;
+      }
+      if (it->second.synced && !it->second.book.verify_checksum(ev))
+        ++mismatches;
+      it->second.book.set_snapshot(ev);
+      it->second.synced = true;
+    } else if (ev.event == Event_type::update && it != channels.end() &&
+               it->second.synced) {
+      changed = it->second.book.update_snapshot(ev);
+    } else {
+      return;
+    }
+
+    perf.stop(Perf_phase::update);
+
+    it->second.latency.record(ev.time, recv_time,
+                              std::chrono::steady_clock::now());
+    check_stale(ev.channel, it->second, std::chrono::steady_clock::now());
+
+    perf.start();
+    it->second.emitter.on_update(it->second.book, changed);
+    it->second.bars.on_update(it->second.book);
+    perf.stop(Perf_phase::output);
+
+    summ_wire_to_bbo_time += std::chrono::steady_clock::now() - recv_time;
+    ++update_counter;
+  };
+
+  auto on_timer = [&](Ws_client::clock::time_point now) {
+    auto now_ms = wall_ms();
+
+    for (auto& [ch, v] : channels) {
+      v.emitter.on_timer(now_ms);
+      v.bars.on_timer(now_ms);
+      check_stale(ch, v, now);
+    }
+  };
+
+  client.run(on_message, on_timer, std::chrono::milliseconds(10));
+
+  for (auto& [ch, v] : channels) {
+    v.emitter.flush();
+    v.bars.flush();
+    v.latency.report(std::cout, ch, std::chrono::steady_clock::now());
+  }
+
+  if (options.checksum_levels != 0)
+    std::cout << "checksum mismatches: " << mismatches << std::endl;
+
+  if (update_counter != 0)
+    std::cout << "average wire-to-bbo time: "
+              << summ_wire_to_bbo_time.count() / update_counter
+              << " nanoseconds" << std::endl;
+
+  if (client.get_dropped_frames() != 0)
+    std::cerr << "error: dropped " << client.get_dropped_frames()
+              << " binary frames that failed to inflate" << std::endl;
+
+  if (client.failed()) {
+    std::cerr << "error: oversized websocket frame" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+template <class Book>
+int run_batch(const std::string& out_dir,
+              const std::vector<std::string>& paths, const Options& options) {
+  std::vector<std::string> outputs;
+  std::map<std::string, size_t> names;
+
+  for (size_t i = 0; i < paths.size(); ++i) {
+    std::string name = std::filesystem::path(paths[i]).filename().string();
+
+    if (auto [it, inserted] = names.try_emplace(name, i); !inserted) {
+      std::cerr << "error: " << paths[it->second] << " and " << paths[i]
+                << " would both be written to " << out_dir << "/" << name
+                << std::endl;
+      return 1;
+    }
+
+    outputs.push_back(out_dir + "/" + name);
+  }
+
+  Line_ingest ingest(paths, options.queue_depth, options.buffer_kb << 10,
+                     options.workers);
+
+  if (auto err = ingest.setup(); !err.empty()) {
+    std::cerr << "error: " << err << std::endl;
+    return 1;
+  }
+
+  std::filesystem::create_directories(out_dir);
+
+  struct File_state {
+    File_state(const std::string& path, size_t depth, const Options& options)
+        : book(options.top_levels, depth, options.checksum_levels),
+          output(path),
+          emitter(output, options.changes_only, options.conflate_ms),
+          bars(path, options.bar_intervals) {}
+
+    Book book;
+    std::ofstream output;
+    Bbo_emitter emitter;
+    Bar_aggregator bars;
+    bool synced = false;
+  };
+
+  std::vector<std::unique_ptr<File_state>> states(paths.size());
+  std::vector<size_t> messages(paths.size());
+  std::atomic<size_t> failed = 0;
+  std::atomic<size_t> mismatches = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  ingest.run(
+      [&](size_t file, const std::string& line) {
+        Processed_data ev = Processed_data(line);
+        auto& state = states[file];
+
+        // The book is capped for the channel of the file's first book
+        // message, as --depth=<channel>:N is applied in live mode.
+        if (!state && (ev.event == Event_type::snapshot ||
+                       ev.event == Event_type::update))
+          state = std::make_unique<File_state>(
+              outputs[file], options.get_depth(ev.channel), options);
+
+        if (ev.event == Event_type::snapshot) {
+          if (state->synced && !state->book.verify_checksum(ev)) ++mismatches;
+          state->book.set_snapshot(ev);
+          state->emitter.on_update(state->book, true);
+          state->bars.on_update(state->book);
+          state->synced = true;
+        } else if (ev.event == Event_type::update && state->synced) {
+          bool changed = state->book.update_snapshot(ev);
+          state->emitter.on_update(state->book, changed);
+          state->bars.on_update(state->book);
+        }
+
+        ++messages[file];
+      },
+      [&](size_t file, bool ok) {
+        if (!ok) {
+          std::cerr << "error: failed to read " << paths[file] << std::endl;
+          ++failed;
+        }
+
+        if (states[file]) {
+          states[file]->emitter.flush();
+          states[file]->bars.flush();
+        }
+        states[file].reset();
+      });
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  size_t total_messages = 0;
+  for (auto v : messages) total_messages += v;
+
+  std::cout << "files: " << paths.size() << ", failed: " << failed
+            << ", messages: " << total_messages << ", read: "
+            << ingest.get_bytes_read() / 1048576.0 << " MiB in "
+            << elapsed.count() << " seconds ("
+            << ingest.get_bytes_read() / 1048576.0 / elapsed.count()
+            << " MiB/s)" << std::endl;
+  if (options.checksum_levels != 0)
+    std::cout << "checksum mismatches: " << mismatches << std::endl;
+
+  return failed == 0 ? 0 : 1;
+}
+
+template <class Book>
+int run_replay(const std::string& input_path, const std::string& output_path,
+               const Options& options, Perf_counters& perf) {
+  std::ifstream input(input_path);
+  std::ofstream output(output_path);
+
+  if (!input.is_open() || !output.is_open()) return 1;
+
+  Bbo_emitter emitter(output, options.changes_only, options.conflate_ms);
+  Bar_aggregator bars(output_path, options.bar_intervals);
+  std::string s = "";
+  std::vector<Processed_data> events;
+
+  std::chrono::duration<double, std::nano> summ_update_time{};
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point end;
+
+  while (std::getline(input, s)) {
+    perf.start();
+    Processed_data ev = Processed_data(s);
+    perf.stop(Perf_phase::parse);
+
+    if (ev.event == Event_type::snapshot || ev.event == Event_type::update)
+      events.push_back(std::move(ev));
+  }
+
+  // The book is capped for the channel of the capture's first book
+  // message, as --depth=<channel>:N is applied in live mode.
+  Book l(options.top_levels,
+         options.get_depth(events.empty() ? "" : events.front().channel),
+         options.checksum_levels);
+
+  bool synced = false;
+  size_t update_counter = 0;
+  size_t mismatches = 0;
+
+  for (const auto& v : events) {
+    if (v.event == Event_type::snapshot) {
+      if (synced && !l.verify_checksum(v)) ++mismatches;
+      l.set_snapshot(v);
+      emitter.on_update(l, true);
+      bars.on_update(l);
+      synced = true;
+      continue;
+    }
+
+    if (!synced) continue;
+
+    perf.start();
+    start = std::chrono::steady_clock::now();
+
+    bool changed = l.update_snapshot(v);
+
+    end = std::chrono::steady_clock::now();
+    perf.stop(Perf_phase::update);
+    summ_update_time += end - start;
+    ++update_counter;
+
+    perf.start();
+    emitter.on_update(l, changed);
+    bars.on_update(l);
+    perf.stop(Perf_phase::output);
+  }
+
+  emitter.flush();
+  bars.flush();
+
+  std::cout << "average update time: "
+            << summ_update_time.count() / update_counter << " nanoseconds"
+            << std::endl;
+  std::cout << "records written: " << emitter.get_written() << std::endl;
+  if (options.checksum_levels != 0)
+    std::cout << "checksum mismatches: " << mismatches << std::endl;
+
+  return 0;
+}
+
+template <class Book>
+int run_engine(int argc, char** argv, const std::string& engine) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0]
+              << " <capture | ws://host:port/path> <output>"
+                 " [--sub=<channel>]... [--busy-poll] [--changes-only]"
+                 " [--top=<levels>] [--conflate-ms=<ms>] [--stale-ms=<ms>]"
+                 " [--depth=[<channel>:]<levels>]... [--checksum=<levels>]"
+                 " [--bars=<ms>[,<ms>]...]\n"
+                 "       "
+              << argv[0]
+              << " --batch <output_dir> <capture>... [--queue-depth=<reads>]"
+                 " [--buffer-kb=<kb>] [--workers=<threads>]"
+                 " [--bars=<ms>[,<ms>]...]\n"
+                 "--depth must be at least the subscription depth"
+              << std::endl;
+    return 1;
+  }
+
+  Options options;
+  Perf_counters perf;
+
+  for (int i = 3; i < argc; ++i) {
+    std::string arg = argv[i];
+
+    if (arg == "--busy-poll")
+      options.busy_poll = true;
+    else if (arg == "--changes-only")
+      options.changes_only = true;
+    else if (arg.rfind("--sub=", 0) == 0)
+      options.subs.push_back(arg.substr(6));
+    else if (arg.rfind("--top=", 0) == 0)
+      options.top_levels = std::max(1ul, std::stoul(arg.substr(6)));
+    else if (arg.rfind("--conflate-ms=", 0) == 0)
+      options.conflate_ms = std::stoul(arg.substr(14));
+    else if (arg.rfind("--stale-ms=", 0) == 0)
+      options.stale_ms = std::stoul(arg.substr(11));
+    else if (arg.rfind("--depth=", 0) == 0) {
+      auto colon = arg.rfind(':');
+      if (colon == std::string::npos)
+        options.depth = std::stoul(arg.substr(8));
+      else
+        options.channel_depth[arg.substr(8, colon - 8)] =
+            std::stoul(arg.substr(colon + 1));
+    } else if (arg.rfind("--queue-depth=", 0) == 0)
+      options.queue_depth = std::max(1ul, std::stoul(arg.substr(14)));
+    else if (arg.rfind("--buffer-kb=", 0) == 0)
+      options.buffer_kb = std::max(4ul, std::stoul(arg.substr(12)));
+    else if (arg.rfind("--workers=", 0) == 0)
+      options.workers = std::stoul(arg.substr(10));
+    else if (arg.rfind("--checksum=", 0) == 0)
+      options.checksum_levels = std::stoul(arg.substr(11));
+    else if (arg.rfind("--bars=", 0) == 0) {
+      for (size_t pos = 7; pos <= arg.size();) {
+        size_t comma = std::min(arg.find(',', pos), arg.size());
+        options.bar_intervals.push_back(
+            std::max(1ul, std::stoul(arg.substr(pos, comma - pos))));
+        pos = comma + 1;
+      }
+    }
+  }
+
+  if (std::string(argv[1]) == "--batch") {
+    std::vector<std::string> paths;
+    for (int i = 3; i < argc; ++i)
+      if (std::string(argv[i]).rfind("--", 0) != 0) paths.push_back(argv[i]);
+
+    return run_batch<Book>(argv[2], paths, options);
+  }
+
+  if (std::string(argv[1]).rfind("ws://", 0) == 0) {
+    std::ofstream output(argv[2]);
+    if (!output.is_open()) return 1;
+
+    int ret = run_live<Book>(argv[1], argv[2], output, options, perf);
+    perf.report(std::cout, engine);
+
+    return ret;
+  }
+
+  int ret = run_replay<Book>(argv[1], argv[2], options, perf);
+  perf.report(std::cout, engine);
+
+  return ret;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+class Rolling_histogram {
+ public:
+  explicit Rolling_histogram(uint64_t slot_ns) : slot_ns(slot_ns) {}
+
+  void add(uint64_t value, uint64_t now_ns) {
+    uint64_t epoch = now_ns / slot_ns;
+    Slot& slot = slots[epoch % slot_count];
+
+    if (slot.epoch != epoch) {
+      slot.counts.fill(0);
+      slot.total = 0;
+      slot.epoch = epoch;
+    }
+
+    ++slot.counts[bucket(value)];
+    ++slot.total;
+    if (value > max) max = value;
+  }
+
+  uint64_t percentile(double q, uint64_t now_ns) const {
+    uint64_t epoch = now_ns / slot_ns;
+    uint64_t total = 0;
+
+    for (const auto& v : slots)
+      if (in_window(v, epoch)) total += v.total;
+    if (total == 0) return 0;
+
+    uint64_t rank = uint64_t(q * (total - 1));
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < bucket_count; ++i) {
+      for (const auto& v : slots)
+        if (in_window(v, epoch)) seen += v.counts[i];
+      if (seen > rank) return lower_bound(i);
+    }
+
+    return max;
+  }
+
+  uint64_t get_max() const { return max; }
+
+ private:
+  static constexpr size_t slot_count = 10;
+  static constexpr size_t bucket_count = 496;
+
+  struct Slot {
+    std::array<uint32_t, bucket_count> counts{};
+    uint64_t total = 0;
+    uint64_t epoch = ~uint64_t(0);
+  };
+
+  static size_t bucket(uint64_t v) {
+    if (v < 16) return v;
+
+    int msb = 63 - __builtin_clzll(v);
+    return 16 + (msb - 4) * 8 + ((v >> (msb - 3)) & 7);
+  }
+
+  static uint64_t lower_bound(size_t i) {
+    if (i < 16) return i;
+
+    return (8 + (i - 16) % 8) << ((i - 16) / 8 + 1);
+  }
+
+  bool in_window(const Slot& v, uint64_t epoch) const {
+    return v.epoch <= epoch && epoch - v.epoch < slot_count;
+  }
+
+  uint64_t slot_ns;
+  uint64_t max = 0;
+  std::array<Slot, slot_count> slots;
+};
+
+class Latency_monitor {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit Latency_monitor(std::chrono::milliseconds stale_after)
+      : stale_after_ns(std::chrono::nanoseconds(stale_after).count()),
+        wall_offset_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch() -
+                clock::now().time_since_epoch())
+                .count()) {}
+
+  void record(unsigned long exchange_ts, clock::time_point recv_time,
+              clock::time_point applied_time) {
+    int64_t recv_ns = to_ns(recv_time);
+    int64_t feed_delay =
+        recv_ns + wall_offset_ns - int64_t(exchange_ts) * 1000000;
+    if (feed_delay < 0) feed_delay = 0;
+
+    feed.add(feed_delay, recv_ns);
+    apply.add(to_ns(applied_time) - recv_ns, recv_ns);
+
+    last_recv_ns = recv_ns;
+    stale = feed_delay > stale_after_ns;
+  }
+
+  bool is_stale(clock::time_point now) const {
+    return last_recv_ns < 0 || stale ||
+           to_ns(now) - last_recv_ns > stale_after_ns;
+  }
+
+  // Re-evaluates is_stale() and returns true when it flipped since the
+  // previous call, so callers can emit the transition.
+  bool poll_stale(clock::time_point now) {
+    bool stale_now = is_stale(now);
+    if (stale_now == reported_stale) return false;
+
+    reported_stale = stale_now;
+    if (stale_now) ++stale_events;
+    return true;
+  }
+
+  bool get_stale() const { return reported_stale; }
+
+  void report(std::ostream& out, const std::string& channel,
+              clock::time_point now) const {
+    int64_t now_ns = to_ns(now);
+
+    out << std::fixed << std::setprecision(1) << "latency " << channel
+        << ": exchange-to-receive p50 " << feed.percentile(0.5, now_ns) / 1e3
+        << " p99 " << feed.percentile(0.99, now_ns) / 1e3 << " max "
+        << feed.get_max() / 1e3 << " microseconds, receive-to-book p50 "
+        << apply.percentile(0.5, now_ns) / 1e3 << " p99 "
+        << apply.percentile(0.99, now_ns) / 1e3 << " max "
+        << apply.get_max() / 1e3 << " microseconds, stale events "
+        << stale_events << (is_stale(now) ? ", stale" : "") << std::endl;
+  }
+
+ private:
+  static int64_t to_ns(clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               t.time_since_epoch())
+        .count();
+  }
+
+  int64_t stale_after_ns;
+  int64_t wall_offset_ns;
+  int64_t last_recv_ns = -1;
+  bool stale = false;
+  bool reported_stale = false;
+  size_t stale_events = 0;
+  Rolling_histogram feed{1000000000};
+  Rolling_histogram apply{1000000000};
+};
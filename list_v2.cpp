@@ -1,116 +1,38 @@
-#include <chrono>
-#include <fstream>
-#include <iomanip>
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <list>
-#include <string>
+#include <memory>
 #include <utility>
 #include <vector>
 
-#include "rapidjson/document.h"
-#include "rapidjson/error/en.h"
+#include "book_checksum.h"
+#include "book_driver.h"
+#include "node_pool.h"
+#include "processed_data.h"
 
-enum class Event_type { undef, error, ping, update, snapshot };
-
-class Processed_data {
+class Limit_order_book {
  public:
-  Event_type event = Event_type::undef;
-  unsigned long time = 0;
-  std::vector<std::pair<double, int>> asks;
-  std::vector<std::pair<double, int>> bids;
-  const std::string members[3] = {"ch", "ts", "tick"};
-  const std::string tick_members[3] = {"asks", "bids", "event"};
-
-  Processed_data(const std::string& str) {
-    rapidjson::Document document;
-    document.Parse(str.c_str() + str.find("{"));
-
-    auto [ev, msg] = check_data(document);
-
-    // std::cerr << msg << " " << str << std::endl;
-
-    switch (ev) {
-      case Event_type::error: {
-        event = Event_type::error;
-        return;
-      }
-      case Event_type::ping: {
-        event = Event_type::ping;
-        return;
-      }
-      case Event_type::snapshot: {
-        event = Event_type::snapshot;
-        fill_data(document);
-        return;
-      }
-      case Event_type::update: {
-        event = Event_type::update;
-        fill_data(document);
-        return;
-      }
-      default:
-        event = Event_type::undef;
-        return;
+  explicit Limit_order_book(size_t top_levels = 1, size_t depth = 0,
+                            size_t checksum_levels = 0)
+      : top_levels(top_levels),
+        depth(depth),
+        checksum_levels(depth ? std::min(checksum_levels, depth)
+                              : checksum_levels),
+        asks_pool(std::make_unique<Node_pool>(pool_capacity(depth))),
+        bids_pool(std::make_unique<Node_pool>(pool_capacity(depth))),
+        asks(Pool_allocator<Level>(asks_pool.get())),
+        bids(Pool_allocator<Level>(bids_pool.get())) {
+    // The first node sizes each pool; allocate it here so a capped book
+    // never touches the heap after construction.
+    if (depth != 0) {
+      asks.emplace_back(0, 0);
+      asks.clear();
+      bids.emplace_back(0, 0);
+      bids.clear();
     }
   }
-
-  std::pair<Event_type, std::string> check_data(
-      const rapidjson::Document& document) const {
-    if (document.HasParseError())
-      return {Event_type::error,
-              "error: " + std::string(rapidjson::GetParseError_En(
-                              document.GetParseError()))};
-
-    if (document.HasMember("ping")) return {Event_type::ping, "ping"};
-
-    for (const auto& v : members) {
-      if (document.HasMember(v.c_str()))
-        continue;
-      else
-        return {Event_type::error, "error: no member: " + std::string(v)};
-    }
-
-    for (const auto& v : tick_members) {
-      if (document["tick"].HasMember(v.c_str()))
-        continue;
-      else
-        return {Event_type::error, "error: no member: " + std::string(v)};
-    }
-
-    for (const auto& v : document["tick"]["asks"].GetArray())
-      if (!v[1].IsInt() && !v[0].IsDouble())
-        return {Event_type::error, "value error"};
-
-    for (const auto& v : document["tick"]["asks"].GetArray())
-      if (!v[1].IsInt() && !v[0].IsDouble())
-        return {Event_type::error, "value error"};
-
-    if (document["tick"]["event"] == "snapshot")
-      return {Event_type::snapshot, "success"};
-    else
-      return {Event_type::update, "success: "};
-  }
-
-  void fill_data(const rapidjson::Document& document) {
-    time = document["ts"].GetUint64();
-
-    for (const auto& v : document["tick"]["asks"].GetArray()) {
-      if (v[1].GetInt() == 0) continue;
-
-      asks.emplace_back(v[0].GetDouble(), v[1].GetInt());
-    }
-
-    for (const auto& v : document["tick"]["bids"].GetArray()) {
-      if (v[1].GetInt() == 0) continue;
-
-      bids.emplace_back(v[0].GetDouble(), v[1].GetInt());
-    }
-  }
-};
-
-class Limit_order_book {
- public:
-  Limit_order_book() = default;
+  Limit_order_book(Limit_order_book&&) = default;
   ~Limit_order_book() = default;
 
   void set_snapshot(const Processed_data& respond) {
@@ -121,117 +43,126 @@ class Limit_order_book {
 
     for (const auto& v : respond.asks) {
       if (v.first == 0) continue;
+      if (depth != 0 && asks.size() == depth) break;
 
       asks.emplace_back(v.first, v.second);
     }
     for (const auto& v : respond.bids) {
       if (v.first == 0) continue;
+      if (depth != 0 && bids.size() == depth) break;
 
       bids.emplace_back(v.first, v.second);
     }
   }
 
-  void update_snapshot(const Processed_data& respond) {
+  bool update_snapshot(const Processed_data& respond) {
     time = respond.time;
 
-    auto updater = [](const auto& doc, auto& list, auto comp) {
+    auto updater = [this](const auto& doc, auto& list, auto comp) {
       auto doc_it = doc.begin();
       auto it = list.begin();
+      size_t pos = 0;
+      bool changed = false;
 
       while (doc_it != doc.end() && it != list.end()) {
-        if (comp(doc_it->first, it->first) && doc_it->second != 0) {
-          list.emplace(it, doc_it->first, doc_it->second);
+        if (comp(doc_it->first, it->first)) {
+          if (doc_it->second != 0) {
+            list.emplace(it, doc_it->first, doc_it->second);
+            changed |= pos < top_levels;
+            truncate(list, it);
+            ++pos;
+          }
 
           ++doc_it;
         } else if (doc_it->first == it->first) {
           if (doc_it->second == 0) {
             list.erase(it++);
+            changed |= pos < top_levels;
             ++doc_it;
           } else {
+            changed |= pos < top_levels && it->second != doc_it->second;
             it->second = doc_it->second;
             ++doc_it;
             ++it;
+            ++pos;
           }
-        } else
+        } else {
           ++it;
+          ++pos;
+        }
       }
 
-      for (; doc_it != doc.end(); ++doc_it)
+      for (; doc_it != doc.end(); ++doc_it) {
+        if (doc_it->second == 0) continue;
+        if (depth != 0 && list.size() == depth) break;
+
         list.emplace_back(doc_it->first, doc_it->second);
+        changed |= pos++ < top_levels;
+      }
+
+      return changed;
     };
 
-    updater(respond.asks, asks, std::less{});
-    updater(respond.bids, bids, std::greater{});
+    bool asks_changed = updater(respond.asks, asks, std::less{});
+    bool bids_changed = updater(respond.bids, bids, std::greater{});
+
+    return asks_changed || bids_changed;
   }
+
   std::pair<double, int> get_best_ask() const {
+    if (asks.empty()) return {0, 0};
+
     return std::make_pair(asks.cbegin()->first, asks.cbegin()->second);
   }
 
   std::pair<double, int> get_best_bid() const {
+    if (bids.empty()) return {0, 0};
+
     return std::make_pair(bids.cbegin()->first, bids.cbegin()->second);
   }
 
-  unsigned long get_time() const { return time; }
-
- private:
-  unsigned long time = 0;
-  std::list<std::pair<double, int>> asks;
-  std::list<std::pair<double, int>> bids;
-};
-
-int main(int argc, char** argv) {
-  std::ifstream input(argv[1]);
-  std::ofstream output(argv[2]);
-
-  if (!input.is_open() || !output.is_open()) return 1;
-
-  Limit_order_book l;
-  std::string s = "";
-  std::vector<Processed_data> updates;
-
-  std::chrono::duration<double, std::nano> summ_update_time;
-  std::chrono::_V2::steady_clock::time_point start;
-  std::chrono::_V2::steady_clock::time_point end;
-
-  size_t r = 0;
-
-  while (std::getline(input, s)) {
-    Processed_data ev = Processed_data(s);
-
-    if (ev.event == Event_type::snapshot) {
-      l.set_snapshot(ev);
+  bool has_bbo() const { return !asks.empty() && !bids.empty(); }
 
-      auto [ask_price, ask_amount] = l.get_best_ask();
-      auto [bid_price, bid_amount] = l.get_best_bid();
+  unsigned long get_time() const { return time; }
 
-      output << std::fixed << std::setprecision(2) << "{" << l.get_time()
-             << "}, {" << bid_price << "}, {" << bid_amount << "}, {"
-             << ask_price << "}, {" << ask_amount << "}" << std::endl;
+  bool verify_checksum(const Processed_data& snapshot) const {
+    if (checksum_levels == 0) return true;
 
-    } else if (ev.event == Event_type::update) {
-      updates.push_back(ev);
-    }
+    return get_checksum() ==
+           top_levels_checksum(snapshot.bids.cbegin(), snapshot.bids.cend(),
+                               snapshot.asks.cbegin(), snapshot.asks.cend(),
+                               checksum_levels);
   }
 
-  for (const auto& v : updates) {
-    start = std::chrono::steady_clock::now();
+  uint32_t get_checksum() const {
+    return top_levels_checksum(bids.cbegin(), bids.cend(), asks.cbegin(),
+                               asks.cend(), checksum_levels);
+  }
 
-    l.update_snapshot(v);
+ private:
+  using Level = std::pair<double, int>;
 
-    end = std::chrono::steady_clock::now();
-    summ_update_time += end - start;
+  static size_t pool_capacity(size_t depth) { return depth ? depth + 1 : 0; }
 
-    auto [ask_price, ask_amount] = l.get_best_ask();
-    auto [bid_price, bid_amount] = l.get_best_bid();
+  template <class List>
+  void truncate(List& list, typename List::iterator& it) {
+    if (depth == 0 || list.size() <= depth) return;
 
-    output << std::fixed << std::setprecision(2) << "{" << l.get_time()
-           << "}, {" << bid_price << "}, {" << bid_amount << "}, {" << ask_price
-           << "}, {" << ask_amount << "}" << std::endl;
+    bool last = std::next(it) == list.end();
+    list.pop_back();
+    if (last) it = list.end();
   }
 
-  std::cout << "average update time: "
-            << summ_update_time.count() / updates.size() << " nanoseconds"
-            << std::endl;
+  unsigned long time = 0;
+  size_t top_levels = 1;
+  size_t depth = 0;
+  size_t checksum_levels = 0;
+  std::unique_ptr<Node_pool> asks_pool;
+  std::unique_ptr<Node_pool> bids_pool;
+  std::list<Level, Pool_allocator<Level>> asks;
+  std::list<Level, Pool_allocator<Level>> bids;
+};
 
-  return 0;
-}
\ No newline at end of file
+int main(int argc, char** argv) {
+  return run_engine<Limit_order_book>(argc, argv, "list");
+}
@@ -1,116 +1,39 @@
-#include <chrono>
-#include <fstream>
-#include <iomanip>
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <map>
-#include <string>
+#include <memory>
 #include <utility>
 #include <vector>
 
-#include "rapidjson/document.h"
-#include "rapidjson/error/en.h"
+#include "book_checksum.h"
+#include "book_driver.h"
+#include "node_pool.h"
+#include "processed_data.h"
 
-enum class Event_type { undef, error, ping, update, snapshot };
-
-class Processed_data {
+class Limit_order_book {
  public:
-  Event_type event = Event_type::undef;
-  unsigned long time = 0;
-  std::vector<std::pair<double, int>> asks;
-  std::vector<std::pair<double, int>> bids;
-  const std::string members[3] = {"ch", "ts", "tick"};
-  const std::string tick_members[3] = {"asks", "bids", "event"};
-
-  Processed_data(const std::string& str) {
-    rapidjson::Document document;
-    document.Parse(str.c_str() + str.find("{"));
-
-    auto [ev, msg] = check_data(document);
-
-    std::cerr << msg << " " << str << std::endl;
-
-    switch (ev) {
-      case Event_type::error: {
-        event = Event_type::error;
-        return;
-      }
-      case Event_type::ping: {
-        event = Event_type::ping;
-        return;
-      }
-      case Event_type::snapshot: {
-        event = Event_type::snapshot;
-        fill_data(document);
-        return;
-      }
-      case Event_type::update: {
-        event = Event_type::update;
-        fill_data(document);
-        return;
-      }
-      default:
-        event = Event_type::undef;
-        return;
-    }
-  }
-
-  std::pair<Event_type, std::string> check_data(
-      const rapidjson::Document& document) const {
-    if (document.HasParseError())
-      return {Event_type::error,
-              "error: " + std::string(rapidjson::GetParseError_En(
-                              document.GetParseError()))};
-
-    if (document.HasMember("ping")) return {Event_type::ping, "ping"};
-
-    for (const auto& v : members) {
-      if (document.HasMember(v.c_str()))
-        continue;
-      else
-        return {Event_type::error, "error: no member: " + std::string(v)};
-    }
-
-    for (const auto& v : tick_members) {
-      if (document["tick"].HasMember(v.c_str()))
-        continue;
-      else
-        return {Event_type::error, "error: no member: " + std::string(v)};
-    }
-
-    for (const auto& v : document["tick"]["asks"].GetArray())
-      if (!v[1].IsInt() && !v[0].IsDouble())
-        return {Event_type::error, "value error"};
-
-    for (const auto& v : document["tick"]["asks"].GetArray())
-      if (!v[1].IsInt() && !v[0].IsDouble())
-        return {Event_type::error, "value error"};
-
-    if (document["tick"]["event"] == "snapshot")
-      return {Event_type::snapshot, "success"};
-    else
-      return {Event_type::update, "success: "};
-  }
-
-  void fill_data(const rapidjson::Document& document) {
-    time = document["ts"].GetUint64();
-
-    for (const auto& v : document["tick"]["asks"].GetArray()) {
-      if (v[1].GetInt() == 0) continue;
-
-      asks.emplace_back(v[0].GetDouble(), v[1].GetInt());
-    }
-
-    for (const auto& v : document["tick"]["bids"].GetArray()) {
-      if (v[1].GetInt() == 0) continue;
-
-      bids.emplace_back(v[0].GetDouble(), v[1].GetInt());
+  explicit Limit_order_book(size_t top_levels = 1, size_t depth = 0,
+                            size_t checksum_levels = 0)
+      : top_levels(top_levels),
+        depth(depth),
+        checksum_levels(depth ? std::min(checksum_levels, depth)
+                              : checksum_levels),
+        asks_pool(std::make_unique<Node_pool>(pool_capacity(depth))),
+        bids_pool(std::make_unique<Node_pool>(pool_capacity(depth))),
+        asks(Pool_allocator<Level>(asks_pool.get())),
+        bids(Pool_allocator<Level>(bids_pool.get())) {
+    // The first node sizes each pool; allocate it here so a capped book
+    // never touches the heap after construction.
+    if (depth != 0) {
+      asks.emplace(0, 0);
+      asks.clear();
+      bids.emplace(0, 0);
+      bids.clear();
     }
   }
-};
-
-class Limit_order_book {
- public:
-  Limit_order_book() = default;
+  Limit_order_book(Limit_order_book&&) = default;
   ~Limit_order_book() = default;
 
   void set_snapshot(const Processed_data& respond) {
@@ -123,102 +46,119 @@ class Limit_order_book {
       if (v.first == 0) continue;
 
       asks[v.first] = v.second;
+      truncate(asks);
     }
 
     for (const auto& v : respond.bids) {
       if (v.first == 0) continue;
 
       bids[v.first] = v.second;
+      truncate(bids);
     }
+
+    asks_bound = top_bound(asks, ask_worst);
+    bids_bound = top_bound(bids, bid_worst);
   }
 
-  void update_snapshot(const Processed_data& respond) {
+  bool update_snapshot(const Processed_data& respond) {
     time = respond.time;
 
-    for (const auto& v : respond.asks) {
-      if (v.first == 0) {
-        asks.erase(v.first);
-        continue;
+    auto updater = [this](const auto& doc, auto& map, double& bound,
+                          double worst) {
+      bool changed = false;
+
+      for (const auto& v : doc) {
+        bool in_top = !map.key_comp()(bound, v.first);
+
+        if (v.second == 0) {
+          changed |= map.erase(v.first) != 0 && in_top;
+          continue;
+        }
+
+        auto [it, inserted] = map.try_emplace(v.first, v.second);
+        if (!inserted) {
+          if (it->second == v.second) continue;
+          it->second = v.second;
+        } else {
+          truncate(map);
+        }
+        changed |= in_top;
       }
-      asks[v.first] = v.second;
-    }
 
-    for (const auto& v : respond.bids) {
-      if (v.first == 0) {
-        bids.erase(v.first);
-        continue;
-      }
-      bids[v.first] = v.second;
-    }
+      if (changed) bound = top_bound(map, worst);
+      return changed;
+    };
+
+    bool asks_changed = updater(respond.asks, asks, asks_bound, ask_worst);
+    bool bids_changed = updater(respond.bids, bids, bids_bound, bid_worst);
+
+    return asks_changed || bids_changed;
   }
 
   std::pair<double, int> get_best_ask() const {
+    if (asks.empty()) return {0, 0};
+
     return {asks.cbegin()->first, asks.cbegin()->second};
   }
 
   std::pair<double, int> get_best_bid() const {
+    if (bids.empty()) return {0, 0};
+
     return {bids.cbegin()->first, bids.cbegin()->second};
   }
 
-  unsigned long get_time() const { return time; }
+  bool has_bbo() const { return !asks.empty() && !bids.empty(); }
 
- private:
-  unsigned long time = 0;
-  std::map<double, int, std::less<>> asks;
-  std::map<double, int, std::greater<>> bids;
-};
-
-int main(int argc, char** argv) {
-  std::ifstream input(argv[1]);
-  std::ofstream output(argv[2]);
-
-  if (!input.is_open() || !output.is_open()) return 1;
+  unsigned long get_time() const { return time; }
 
-  Limit_order_book l;
-  std::string s = "";
-  std::vector<Processed_data> updates;
+  // Compares the book's top levels with a new snapshot before it is
+  // applied. Nothing is tracked per update; the CRC is computed here.
+  bool verify_checksum(const Processed_data& snapshot) const {
+    if (checksum_levels == 0) return true;
 
-  std::chrono::duration<double, std::nano> summ_update_time;
-  std::chrono::_V2::steady_clock::time_point start;
-  std::chrono::_V2::steady_clock::time_point end;
+    return get_checksum() ==
+           top_levels_checksum(snapshot.bids.cbegin(), snapshot.bids.cend(),
+                               snapshot.asks.cbegin(), snapshot.asks.cend(),
+                               checksum_levels);
+  }
 
-  while (std::getline(input, s)) {
-    Processed_data ev = Processed_data(s);
+  uint32_t get_checksum() const {
+    return top_levels_checksum(bids.cbegin(), bids.cend(), asks.cbegin(),
+                               asks.cend(), checksum_levels);
+  }
 
-    if (ev.event == Event_type::snapshot) {
-      l.set_snapshot(ev);
+ private:
+  using Level = std::pair<const double, int>;
 
-      auto [ask_price, ask_amount] = l.get_best_ask();
-      auto [bid_price, bid_amount] = l.get_best_bid();
+  static constexpr double ask_worst = std::numeric_limits<double>::infinity();
+  static constexpr double bid_worst = -ask_worst;
 
-      output << std::fixed << std::setprecision(2) << "{" << l.get_time()
-             << "}, {" << bid_price << "}, {" << bid_amount << "}, {"
-             << ask_price << "}, {" << ask_amount << "}" << std::endl;
+  static size_t pool_capacity(size_t depth) { return depth ? depth + 1 : 0; }
 
-    } else if (ev.event == Event_type::update) {
-      updates.push_back(std::move(ev));
-    }
+  template <class Map>
+  void truncate(Map& map) {
+    if (depth != 0 && map.size() > depth) map.erase(std::prev(map.end()));
   }
 
-  for (const auto& v : updates) {
-    start = std::chrono::steady_clock::now();
-
-    l.update_snapshot(v);
-
-    end = std::chrono::steady_clock::now();
-    summ_update_time += end - start;
-
-    auto [ask_price, ask_amount] = l.get_best_ask();
-    auto [bid_price, bid_amount] = l.get_best_bid();
+  template <class Map>
+  double top_bound(const Map& map, double worst) const {
+    if (map.size() < top_levels) return worst;
 
-    output << std::fixed << std::setprecision(2) << "{" << l.get_time()
-           << "}, {" << bid_price << "}, {" << bid_amount << "}, {" << ask_price
-           << "}, {" << ask_amount << "}" << std::endl;
+    return std::next(map.cbegin(), top_levels - 1)->first;
   }
 
-  std::cout << "average update time: "
-            << summ_update_time.count() / updates.size() << " nanoseconds"
-            << std::endl;
+  unsigned long time = 0;
+  size_t top_levels = 1;
+  size_t depth = 0;
+  size_t checksum_levels = 0;
+  double asks_bound = ask_worst;
+  double bids_bound = bid_worst;
+  std::unique_ptr<Node_pool> asks_pool;
+  std::unique_ptr<Node_pool> bids_pool;
+  std::map<double, int, std::less<>, Pool_allocator<Level>> asks;
+  std::map<double, int, std::greater<>, Pool_allocator<Level>> bids;
+};
 
-  return 0;
-}
\ No newline at end of file
+int main(int argc, char** argv) {
+  return run_engine<Limit_order_book>(argc, argv, "map");
+}
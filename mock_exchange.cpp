@@ -0,0 +1,197 @@
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "rapidjson/document.h"
+#include "websocket.h"
+
+unsigned long now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void restamp(std::string& json, unsigned long ts) {
+  const std::string key = "\"ts\":";
+  std::string value = std::to_string(ts);
+
+  for (auto pos = json.find(key); pos != std::string::npos;
+       pos = json.find(key, pos)) {
+    pos += key.size();
+    while (pos < json.size() && json[pos] == ' ') ++pos;
+
+    auto end = pos;
+    while (end < json.size() && std::isdigit(json[end])) ++end;
+    json.replace(pos, end - pos, value);
+  }
+}
+
+class Mock_exchange {
+ public:
+  Mock_exchange() = default;
+  ~Mock_exchange() {
+    if (client_fd >= 0) ::close(client_fd);
+    if (listen_fd >= 0) ::close(listen_fd);
+  }
+
+  bool listen(unsigned short port) {
+    listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) return false;
+
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ||
+        ::listen(listen_fd, 1))
+      return false;
+
+    return true;
+  }
+
+  bool accept() {
+    client_fd = ::accept(listen_fd, nullptr, nullptr);
+    if (client_fd < 0) return false;
+
+    int one = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::string request;
+    char buf[4096];
+    size_t header_end;
+    while ((header_end = request.find("\r\n\r\n")) == std::string::npos) {
+      ssize_t n = ::recv(client_fd, buf, sizeof(buf), 0);
+      if (n <= 0) return false;
+      request.append(buf, n);
+    }
+
+    const std::string key_header = "Sec-WebSocket-Key: ";
+    auto key_pos = request.find(key_header);
+    if (key_pos == std::string::npos) return false;
+    key_pos += key_header.size();
+    std::string key =
+        request.substr(key_pos, request.find("\r\n", key_pos) - key_pos);
+
+    std::string response =
+        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+        "Connection: Upgrade\r\nSec-WebSocket-Accept: " +
+        ws_accept_key(key) + "\r\n\r\n";
+    if (!send_all(client_fd, response)) return false;
+
+    reader.feed(request.data() + header_end + 4,
+                request.size() - header_end - 4);
+
+    return true;
+  }
+
+  void send(std::string_view json) {
+    send_all(client_fd,
+             encode_frame(Ws_opcode::binary, deflater.deflate(json), false));
+  }
+
+  void close() {
+    send_all(client_fd, encode_frame(Ws_opcode::close, "", false));
+  }
+
+  void poll_client(int timeout_ms) {
+    pollfd pfd{client_fd, POLLIN, 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0) return;
+
+    char buf[4096];
+    ssize_t n = ::recv(client_fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n > 0) reader.feed(buf, n);
+
+    Ws_opcode opcode;
+    std::string payload;
+    while (reader.next(opcode, payload)) {
+      if (opcode != Ws_opcode::text) continue;
+
+      if (payload.find("\"pong\"") != std::string::npos)
+        ++pongs;
+      else
+        std::cerr << "client: " << payload << std::endl;
+    }
+  }
+
+  size_t get_pongs() const { return pongs; }
+
+ private:
+  int listen_fd = -1;
+  int client_fd = -1;
+  size_t pongs = 0;
+  Ws_frame_reader reader;
+  Gzip_deflater deflater;
+};
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <capture> <port> [speed]"
+              << std::endl;
+    return 1;
+  }
+
+  std::ifstream input(argv[1]);
+  if (!input.is_open()) return 1;
+
+  double speed = argc > 3 ? std::stod(argv[3]) : 1.0;
+
+  Mock_exchange exchange;
+  if (!exchange.listen(std::stoi(argv[2]))) return 1;
+  if (!exchange.accept()) return 1;
+
+  exchange.poll_client(1000);
+
+  using clock = std::chrono::steady_clock;
+  const auto ping_interval = std::chrono::seconds(5);
+
+  std::string s = "";
+  size_t sent = 0;
+  unsigned long first_ts = 0;
+  clock::time_point start = clock::now();
+  clock::time_point last_ping = start;
+
+  while (std::getline(input, s)) {
+    auto brace = s.find("{");
+    if (brace == std::string::npos) continue;
+    std::string json = s.substr(brace);
+
+    rapidjson::Document document;
+    document.Parse(json.c_str());
+
+    if (speed > 0 && !document.HasParseError() && document.HasMember("ts")) {
+      unsigned long ts = document["ts"].GetUint64();
+      if (first_ts == 0) first_ts = ts;
+
+      std::this_thread::sleep_until(
+          start + std::chrono::duration<double, std::milli>((ts - first_ts) /
+                                                            speed));
+    }
+
+    restamp(json, now_ms());
+    exchange.send(json);
+    ++sent;
+
+    if (clock::now() - last_ping >= ping_interval) {
+      last_ping = clock::now();
+      exchange.send("{\"ping\": " + std::to_string(now_ms()) + "}");
+    }
+
+    exchange.poll_client(0);
+  }
+
+  exchange.poll_client(100);
+  exchange.close();
+
+  std::cout << "sent: " << sent << " messages in "
+            << std::chrono::duration<double>(clock::now() - start).count()
+            << " seconds, pongs: " << exchange.get_pongs() << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+class Node_pool {
+ public:
+  explicit Node_pool(size_t capacity) : capacity(capacity) {}
+
+  Node_pool(const Node_pool&) = delete;
+  Node_pool& operator=(const Node_pool&) = delete;
+
+  void* allocate(size_t size) {
+    if (capacity == 0) return ::operator new(size);
+    if (!storage) reserve(size);
+    if (size > slot_size || free_list == nullptr) throw std::bad_alloc();
+
+    Slot* slot = free_list;
+    free_list = slot->next;
+    return slot;
+  }
+
+  void deallocate(void* p) {
+    if (capacity == 0) return ::operator delete(p);
+
+    auto* slot = static_cast<Slot*>(p);
+    slot->next = free_list;
+    free_list = slot;
+  }
+
+ private:
+  struct Slot {
+    Slot* next;
+  };
+
+  // Slots are sized by the first request, which is the container's node
+  // type; its layout is library-specific, so the pool does not guess it.
+  // The books make that request when they are constructed.
+  void reserve(size_t size) {
+    slot_size = round_up(std::max(size, sizeof(Slot)));
+    storage.reset(new std::byte[slot_size * capacity]);
+
+    for (size_t i = capacity; i-- > 0;) {
+      auto* slot = reinterpret_cast<Slot*>(storage.get() + i * slot_size);
+      slot->next = free_list;
+      free_list = slot;
+    }
+  }
+
+  static size_t round_up(size_t size) {
+    constexpr size_t align = alignof(std::max_align_t);
+    return (size + align - 1) / align * align;
+  }
+
+  size_t slot_size = 0;
+  size_t capacity;
+  std::unique_ptr<std::byte[]> storage;
+  Slot* free_list = nullptr;
+};
+
+template <class T>
+class Pool_allocator {
+ public:
+  using value_type = T;
+
+  explicit Pool_allocator(Node_pool* pool) : pool(pool) {}
+
+  template <class U>
+  Pool_allocator(const Pool_allocator<U>& other) : pool(other.pool) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(pool->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t) { pool->deallocate(p); }
+
+  template <class U>
+  bool operator==(const Pool_allocator<U>& other) const {
+    return pool == other.pool;
+  }
+
+  template <class U>
+  bool operator!=(const Pool_allocator<U>& other) const {
+    return pool != other.pool;
+  }
+
+ private:
+  template <class U>
+  friend class Pool_allocator;
+
+  Node_pool* pool;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+#ifdef PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+enum class Perf_phase { parse, update, output, count };
+
+#ifdef PERF_COUNTERS
+
+class Perf_counters {
+ public:
+  Perf_counters() {
+    const std::pair<uint32_t, uint64_t> events[counter_count] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                 (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+
+    for (size_t i = 0; i < counter_count; ++i) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = events[i].first;
+      attr.config = events[i].second;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+
+      fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1,
+                       leader() < 0 ? -1 : leader(), 0);
+      if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_ID, &ids[i]);
+    }
+
+    if (leader() < 0) return;
+
+    ioctl(leader(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  ~Perf_counters() {
+    for (int fd : fds)
+      if (fd >= 0) close(fd);
+  }
+
+  Perf_counters(const Perf_counters&) = delete;
+  Perf_counters& operator=(const Perf_counters&) = delete;
+
+  void start() { read_group(started); }
+
+  void stop(Perf_phase phase) {
+    uint64_t now[counter_count];
+    read_group(now);
+
+    auto& total = totals[size_t(phase)];
+    for (size_t i = 0; i < counter_count; ++i)
+      total.values[i] += now[i] - started[i];
+    ++total.calls;
+  }
+
+  void report(std::ostream& out, const std::string& engine) const {
+    if (leader() < 0) {
+      out << engine << ": perf counters unavailable" << std::endl;
+      return;
+    }
+
+    const char* phases[] = {"parse", "update", "output"};
+    const char* names[counter_count] = {"cycles", "instructions", "l1d-miss",
+                                        "llc-miss", "branch-miss"};
+
+    for (size_t p = 0; p < size_t(Perf_phase::count); ++p) {
+      const auto& total = totals[p];
+      if (total.calls == 0) continue;
+
+      out << engine << " " << phases[p] << " (" << total.calls << " calls):";
+      for (size_t i = 0; i < counter_count; ++i) {
+        if (fds[i] < 0) continue;
+        out << " " << names[i] << " " << std::fixed << std::setprecision(1)
+            << double(total.values[i]) / total.calls;
+      }
+      if (fds[0] >= 0 && fds[1] >= 0 && total.values[0] != 0)
+        out << " ipc " << std::setprecision(2)
+            << double(total.values[1]) / total.values[0];
+      out << std::endl;
+    }
+  }
+
+ private:
+  static constexpr size_t counter_count = 5;
+
+  struct Total {
+    uint64_t values[counter_count] = {};
+    uint64_t calls = 0;
+  };
+
+  int leader() const { return fds[0]; }
+
+  void read_group(uint64_t* out) const {
+    struct {
+      uint64_t nr;
+      struct {
+        uint64_t value;
+        uint64_t id;
+      } values[counter_count];
+    } data;
+
+    for (size_t i = 0; i < counter_count; ++i) out[i] = 0;
+    if (leader() < 0 || read(leader(), &data, sizeof(data)) <= 0) return;
+
+    for (uint64_t n = 0; n < data.nr; ++n)
+      for (size_t i = 0; i < counter_count; ++i)
+        if (fds[i] >= 0 && ids[i] == data.values[n].id)
+          out[i] = data.values[n].value;
+  }
+
+  int fds[counter_count] = {-1, -1, -1, -1, -1};
+  uint64_t ids[counter_count] = {};
+  uint64_t started[counter_count] = {};
+  Total totals[size_t(Perf_phase::count)];
+};
+
+#else
+
+class Perf_counters {
+ public:
+  void start() {}
+  void stop(Perf_phase) {}
+  void report(std::ostream&, const std::string&) const {}
+};
+
+#endif
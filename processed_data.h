@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rapidjson/document.h"
+#include "rapidjson/error/en.h"
+
+enum class Event_type { undef, error, ping, update, snapshot };
+
+class Processed_data {
+ public:
+  Event_type event = Event_type::undef;
+  unsigned long time = 0;
+  std::string channel = "";
+  std::vector<std::pair<double, int>> asks;
+  std::vector<std::pair<double, int>> bids;
+  const std::string members[3] = {"ch", "ts", "tick"};
+  const std::string tick_members[3] = {"asks", "bids", "event"};
+
+  Processed_data(const std::string& str) {
+    auto begin = str.find('{');
+    if (begin == std::string::npos) {
+      event = Event_type::error;
+      return;
+    }
+
+    rapidjson::Document document;
+    document.Parse(str.c_str() + begin);
+
+    auto [ev, msg] = check_data(document);
+
+    // std::cerr << msg << " " << str << std::endl;
+
+    switch (ev) {
+      case Event_type::error: {
+        event = Event_type::error;
+        return;
+      }
+      case Event_type::ping: {
+        event = Event_type::ping;
+        time = document["ping"].GetUint64();
+        return;
+      }
+      case Event_type::snapshot: {
+        event = Event_type::snapshot;
+        fill_data(document);
+        return;
+      }
+      case Event_type::update: {
+        event = Event_type::update;
+        fill_data(document);
+        return;
+      }
+      default:
+        event = Event_type::undef;
+        return;
+    }
+  }
+
+  std::pair<Event_type, std::string> check_data(
+      const rapidjson::Document& document) const {
+    if (document.HasParseError())
+      return {Event_type::error,
+              "error: " + std::string(rapidjson::GetParseError_En(
+                              document.GetParseError()))};
+
+    if (document.HasMember("ping")) return {Event_type::ping, "ping"};
+
+    for (const auto& v : members) {
+      if (document.HasMember(v.c_str()))
+        continue;
+      else
+        return {Event_type::error, "error: no member: " + std::string(v)};
+    }
+
+    for (const auto& v : tick_members) {
+      if (document["tick"].HasMember(v.c_str()))
+        continue;
+      else
+        return {Event_type::error, "error: no member: " + std::string(v)};
+    }
+
+    for (const auto& v : document["tick"]["asks"].GetArray())
+      if (!v[1].IsInt() && !v[0].IsDouble())
+        return {Event_type::error, "value error"};
+
+    for (const auto& v : document["tick"]["asks"].GetArray())
+      if (!v[1].IsInt() && !v[0].IsDouble())
+        return {Event_type::error, "value error"};
+
+    if (document["tick"]["event"] == "snapshot")
+      return {Event_type::snapshot, "success"};
+    else
+      return {Event_type::update, "success: "};
+  }
+
+  void fill_data(const rapidjson::Document& document) {
+    time = document["ts"].GetUint64();
+    channel = document["ch"].GetString();
+
+    for (const auto& v : document["tick"]["asks"].GetArray()) {
+      if (v[1].GetInt() == 0 && event == Event_type::snapshot) continue;
+
+      asks.emplace_back(v[0].GetDouble(), v[1].GetInt());
+    }
+
+    for (const auto& v : document["tick"]["bids"].GetArray()) {
+      if (v[1].GetInt() == 0 && event == Event_type::snapshot) continue;
+
+      bids.emplace_back(v[0].GetDouble(), v[1].GetInt());
+    }
+  }
+};
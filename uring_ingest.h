@@ -0,0 +1,509 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Uring_reader {
+ public:
+  Uring_reader(const std::vector<std::string>& paths, unsigned queue_depth,
+               size_t buffer_size)
+      : queue_depth(queue_depth),
+        buffer_size(buffer_size),
+        files(paths.size()),
+        ranges(queue_depth) {
+    for (size_t i = 0; i < paths.size(); ++i) files[i].path = paths[i];
+  }
+
+  ~Uring_reader() {
+    for (auto& v : files)
+      if (v.fd >= 0) close(v.fd);
+    if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+      munmap(cq_ring, cq_ring_size);
+    if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+    if (ring_fd >= 0) close(ring_fd);
+    std::free(buffers);
+  }
+
+  Uring_reader(const Uring_reader&) = delete;
+  Uring_reader& operator=(const Uring_reader&) = delete;
+
+  std::string setup() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ring_fd = syscall(SYS_io_uring_setup, queue_depth, &params);
+    if (ring_fd < 0) return std::string("io_uring_setup: ") + strerror(errno);
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) return "mmap sq ring failed";
+
+    cq_ring = sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+      cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+      if (cq_ring == MAP_FAILED) return "mmap cq ring failed";
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return "mmap sqes failed";
+
+    auto* sq = static_cast<char*>(sq_ring);
+    sq_tail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+
+    auto* cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    buffers = static_cast<char*>(
+        std::aligned_alloc(4096, size_t(queue_depth) * buffer_size));
+    if (buffers == nullptr) return "buffer allocation failed";
+
+    std::vector<iovec> iovecs(queue_depth);
+    for (unsigned i = 0; i < queue_depth; ++i) {
+      iovecs[i] = {buffers + i * buffer_size, buffer_size};
+      free_buffers.push_back(i);
+    }
+
+    if (syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS,
+                iovecs.data(), queue_depth) < 0)
+      return std::string("io_uring_register: ") + strerror(errno);
+
+    return "";
+  }
+
+  template <class Chunk_handler, class Eof_handler>
+  void run(Chunk_handler&& on_chunk, Eof_handler&& on_eof) {
+    while (true) {
+      collect_released();
+      activate_files();
+      submit_reads();
+
+      if (inflight != 0) {
+        if (submit() && wait())
+          reap();
+        else
+          fail_ring();
+      }
+
+      deliver(on_chunk, on_eof);
+
+      if (active.empty() && next_file == files.size()) return;
+
+      if (!broken && inflight == 0 && free_buffers.empty()) {
+        std::unique_lock lock(released_mutex);
+        released_cv.wait(lock, [this] { return !released.empty(); });
+      }
+    }
+  }
+
+  void release(int buffer) {
+    {
+      std::lock_guard lock(released_mutex);
+      released.push_back(buffer);
+    }
+    released_cv.notify_one();
+  }
+
+  const std::string& get_path(size_t file) const { return files[file].path; }
+  uint64_t get_bytes_read() const { return bytes_read; }
+
+ private:
+  struct Range {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t done;
+  };
+
+  struct Chunk {
+    int buffer;
+    uint32_t size;
+  };
+
+  struct File {
+    std::string path;
+    int fd = -1;
+    uint64_t size = 0;
+    uint64_t next_submit = 0;
+    uint64_t next_deliver = 0;
+    size_t inflight = 0;
+    std::map<uint64_t, Chunk> completed;
+    bool failed = false;
+  };
+
+  void collect_released() {
+    std::lock_guard lock(released_mutex);
+    free_buffers.insert(free_buffers.end(), released.begin(), released.end());
+    released.clear();
+  }
+
+  void activate_files() {
+    while (active.size() < queue_depth && next_file < files.size()) {
+      File& f = files[next_file];
+      if (broken) {
+        f.failed = true;
+        active.push_back(next_file++);
+        continue;
+      }
+
+      f.fd = open(f.path.c_str(), O_RDONLY);
+
+      struct stat st;
+      if (f.fd < 0 || fstat(f.fd, &st) != 0) {
+        f.failed = true;
+      } else {
+        f.size = st.st_size;
+        posix_fadvise(f.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      }
+
+      active.push_back(next_file++);
+    }
+  }
+
+  void submit_reads() {
+    size_t idle = 0;
+
+    while (!free_buffers.empty() && !active.empty() && idle < active.size()) {
+      size_t file = active[cursor++ % active.size()];
+      File& f = files[file];
+
+      if (f.failed || f.next_submit == f.size) {
+        ++idle;
+        continue;
+      }
+
+      Range range{f.next_submit,
+                  uint32_t(std::min<uint64_t>(buffer_size,
+                                              f.size - f.next_submit)),
+                  0};
+      f.next_submit += range.size;
+
+      idle = 0;
+      int buffer = free_buffers.back();
+      free_buffers.pop_back();
+
+      ranges[buffer] = range;
+      queue_read(file, buffer);
+    }
+  }
+
+  // Queues a read of the part of the buffer's range not read yet.
+  void queue_read(size_t file, int buffer) {
+    const Range& range = ranges[buffer];
+    File& f = files[file];
+
+    uint32_t tail = *sq_tail;
+    uint32_t index = tail & sq_mask;
+    auto& sqe = static_cast<io_uring_sqe*>(sqes)[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ_FIXED;
+    sqe.fd = f.fd;
+    sqe.off = range.offset + range.done;
+    sqe.addr = reinterpret_cast<uint64_t>(buffers + buffer * buffer_size +
+                                          range.done);
+    sqe.len = range.size - range.done;
+    sqe.buf_index = buffer;
+    sqe.user_data = (uint64_t(file) << 32) | uint32_t(buffer);
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    ++f.inflight;
+    ++inflight;
+    ++unsubmitted;
+  }
+
+  // Hands queued reads to the kernel. Reads it does not take (a partial
+  // submit, or EAGAIN/EBUSY while it is short of resources) stay queued
+  // and are retried on the next pass; false means the ring is unusable.
+  bool submit() {
+    while (unsubmitted != 0) {
+      long n = syscall(SYS_io_uring_enter, ring_fd, unsubmitted, 0, 0,
+                       nullptr, 0);
+      if (n > 0) {
+        unsubmitted -= n;
+        continue;
+      }
+      if (n < 0 && errno == EINTR) continue;
+      if (n == 0 || errno == EAGAIN || errno == EBUSY) return true;
+      return false;
+    }
+
+    return true;
+  }
+
+  // Blocks for one completion, but only when the kernel holds a read;
+  // otherwise it yields so queued reads are resubmitted next pass.
+  bool wait() {
+    if (inflight == unsubmitted) {
+      std::this_thread::yield();
+      return true;
+    }
+
+    long n = syscall(SYS_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS,
+                     nullptr, 0);
+    return n >= 0 || errno == EINTR || errno == EAGAIN || errno == EBUSY;
+  }
+
+  // After a hard io_uring_enter error nothing more can be read or reaped:
+  // every active and remaining file is failed.
+  void fail_ring() {
+    broken = true;
+    for (size_t file : active) {
+      files[file].failed = true;
+      files[file].inflight = 0;
+    }
+    inflight = 0;
+    unsubmitted = 0;
+  }
+
+  void reap() {
+    uint32_t head = *cq_head;
+    uint32_t tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cqes[head & cq_mask];
+      size_t file = cqe.user_data >> 32;
+      int buffer = int(cqe.user_data & 0xFFFFFFFF);
+      File& f = files[file];
+      Range& range = ranges[buffer];
+
+      --f.inflight;
+      --inflight;
+
+      // A short read is resumed from where it stopped; only an error, or
+      // end of file before the range is filled, fails the file.
+      if (cqe.res <= 0) {
+        f.failed = true;
+        free_buffers.push_back(buffer);
+        continue;
+      }
+
+      range.done += cqe.res;
+      bytes_read += cqe.res;
+
+      if (range.done < range.size)
+        queue_read(file, buffer);
+      else
+        f.completed[range.offset] = {buffer, range.size};
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  template <class Chunk_handler, class Eof_handler>
+  void deliver(Chunk_handler& on_chunk, Eof_handler& on_eof) {
+    for (size_t i = 0; i < active.size();) {
+      size_t file = active[i];
+      File& f = files[file];
+
+      for (auto it = f.completed.begin();
+           !f.failed && it != f.completed.end() &&
+           it->first == f.next_deliver;
+           it = f.completed.erase(it)) {
+        f.next_deliver += it->second.size;
+        on_chunk(file, buffers + it->second.buffer * buffer_size,
+                 size_t(it->second.size), it->second.buffer);
+      }
+
+      bool done = f.failed ? f.inflight == 0
+                           : f.next_deliver == f.size && f.inflight == 0;
+      if (!done) {
+        ++i;
+        continue;
+      }
+
+      for (auto& [offset, chunk] : f.completed)
+        free_buffers.push_back(chunk.buffer);
+      f.completed.clear();
+      if (f.fd >= 0) close(f.fd);
+      f.fd = -1;
+
+      on_eof(file, !f.failed);
+      active.erase(active.begin() + i);
+    }
+  }
+
+  unsigned queue_depth;
+  size_t buffer_size;
+  std::vector<File> files;
+  std::vector<size_t> active;
+  size_t next_file = 0;
+  size_t cursor = 0;
+  size_t inflight = 0;
+  size_t unsubmitted = 0;
+  bool broken = false;
+  uint64_t bytes_read = 0;
+
+  int ring_fd = -1;
+  void* sq_ring = MAP_FAILED;
+  void* cq_ring = MAP_FAILED;
+  void* sqes = MAP_FAILED;
+  size_t sq_ring_size = 0;
+  size_t cq_ring_size = 0;
+  size_t sqes_size = 0;
+  uint32_t* sq_tail = nullptr;
+  uint32_t sq_mask = 0;
+  uint32_t* sq_array = nullptr;
+  uint32_t* cq_head = nullptr;
+  uint32_t* cq_tail = nullptr;
+  uint32_t cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
+
+  char* buffers = nullptr;
+  std::vector<int> free_buffers;
+  std::vector<Range> ranges;
+
+  std::mutex released_mutex;
+  std::condition_variable released_cv;
+  std::vector<int> released;
+};
+
+class Line_ingest {
+ public:
+  Line_ingest(const std::vector<std::string>& paths, unsigned queue_depth,
+              size_t buffer_size, unsigned workers)
+      : reader(paths, queue_depth, buffer_size),
+        file_count(paths.size()),
+        workers(workers) {}
+
+  std::string setup() { return reader.setup(); }
+
+  template <class Line_handler, class Close_handler>
+  void run(Line_handler&& on_line, Close_handler&& on_close) {
+    std::vector<std::string> carries(file_count);
+
+    auto split = [&](size_t file, const char* data, size_t size) {
+      std::string& carry = carries[file];
+      const char* end = data + size;
+
+      while (data != end) {
+        auto* nl =
+            static_cast<const char*>(std::memchr(data, '\n', end - data));
+        if (nl == nullptr) {
+          carry.append(data, end);
+          return;
+        }
+
+        carry.append(data, nl);
+        if (!carry.empty()) on_line(file, carry);
+        carry.clear();
+        data = nl + 1;
+      }
+    };
+
+    auto finish = [&](size_t file, bool ok) {
+      std::string& carry = carries[file];
+      if (!carry.empty()) on_line(file, carry);
+      carry = std::string();
+      on_close(file, ok);
+    };
+
+    if (workers == 0) {
+      reader.run(
+          [&](size_t file, const char* data, size_t size, int buffer) {
+            split(file, data, size);
+            reader.release(buffer);
+          },
+          finish);
+      return;
+    }
+
+    std::vector<Worker> pool(workers);
+
+    for (auto& w : pool)
+      w.thread = std::thread([&] {
+        while (true) {
+          Task task;
+          {
+            std::unique_lock lock(w.mutex);
+            w.cv.wait(lock, [&] { return !w.tasks.empty(); });
+            task = w.tasks.front();
+            w.tasks.pop_front();
+          }
+
+          if (task.kind == Task::stop) return;
+
+          if (task.kind == Task::eof) {
+            finish(task.file, task.ok);
+          } else {
+            split(task.file, task.data, task.size);
+            reader.release(task.buffer);
+          }
+        }
+      });
+
+    auto push = [&](const Task& task) {
+      Worker& w = pool[task.file % workers];
+      {
+        std::lock_guard lock(w.mutex);
+        w.tasks.push_back(task);
+      }
+      w.cv.notify_one();
+    };
+
+    reader.run(
+        [&](size_t file, const char* data, size_t size, int buffer) {
+          push({Task::chunk, file, data, size, buffer, true});
+        },
+        [&](size_t file, bool ok) {
+          push({Task::eof, file, nullptr, 0, -1, ok});
+        });
+
+    for (size_t i = 0; i < pool.size(); ++i)
+      push({Task::stop, i, nullptr, 0, -1, true});
+    for (auto& w : pool) w.thread.join();
+  }
+
+  uint64_t get_bytes_read() const { return reader.get_bytes_read(); }
+
+ private:
+  struct Task {
+    enum Kind { chunk, eof, stop } kind = chunk;
+    size_t file = 0;
+    const char* data = nullptr;
+    size_t size = 0;
+    int buffer = -1;
+    bool ok = true;
+  };
+
+  struct Worker {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Task> tasks;
+  };
+
+  Uring_reader reader;
+  size_t file_count;
+  unsigned workers;
+};
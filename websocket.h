@@ -0,0 +1,519 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+
+enum class Ws_opcode : uint8_t {
+  continuation = 0x0,
+  text = 0x1,
+  binary = 0x2,
+  close = 0x8,
+  ping = 0x9,
+  pong = 0xA
+};
+
+inline std::string base64_encode(std::string_view in) {
+  static const char table[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((in.size() + 2) / 3 * 4);
+
+  size_t i = 0;
+  for (; i + 2 < in.size(); i += 3) {
+    uint32_t n = (uint8_t(in[i]) << 16) | (uint8_t(in[i + 1]) << 8) |
+                 uint8_t(in[i + 2]);
+    out += table[(n >> 18) & 63];
+    out += table[(n >> 12) & 63];
+    out += table[(n >> 6) & 63];
+    out += table[n & 63];
+  }
+
+  if (i + 1 == in.size()) {
+    uint32_t n = uint8_t(in[i]) << 16;
+    out += table[(n >> 18) & 63];
+    out += table[(n >> 12) & 63];
+    out += "==";
+  } else if (i + 2 == in.size()) {
+    uint32_t n = (uint8_t(in[i]) << 16) | (uint8_t(in[i + 1]) << 8);
+    out += table[(n >> 18) & 63];
+    out += table[(n >> 12) & 63];
+    out += table[(n >> 6) & 63];
+    out += '=';
+  }
+
+  return out;
+}
+
+inline std::string sha1(std::string_view in) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+  auto rol = [](uint32_t v, int s) { return (v << s) | (v >> (32 - s)); };
+
+  std::string msg(in);
+  uint64_t bits = uint64_t(in.size()) * 8;
+  msg += char(0x80);
+  while (msg.size() % 64 != 56) msg += char(0);
+  for (int i = 7; i >= 0; --i) msg += char(bits >> (i * 8));
+
+  for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i)
+      w[i] = (uint8_t(msg[chunk + i * 4]) << 24) |
+             (uint8_t(msg[chunk + i * 4 + 1]) << 16) |
+             (uint8_t(msg[chunk + i * 4 + 2]) << 8) |
+             uint8_t(msg[chunk + i * 4 + 3]);
+    for (int i = 16; i < 80; ++i)
+      w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rol(b, 30);
+      b = a;
+      a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  std::string out;
+  for (auto v : h)
+    for (int i = 3; i >= 0; --i) out += char(v >> (i * 8));
+  return out;
+}
+
+inline std::string ws_accept_key(std::string_view key) {
+  return base64_encode(
+      sha1(std::string(key) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+}
+
+inline std::string encode_frame(Ws_opcode opcode, std::string_view payload,
+                                bool masked) {
+  std::string frame;
+  frame.reserve(payload.size() + 14);
+  frame += char(0x80 | uint8_t(opcode));
+
+  const uint8_t mask_bit = masked ? 0x80 : 0;
+  if (payload.size() < 126) {
+    frame += char(mask_bit | payload.size());
+  } else if (payload.size() <= 0xFFFF) {
+    frame += char(mask_bit | 126);
+    frame += char(payload.size() >> 8);
+    frame += char(payload.size());
+  } else {
+    frame += char(mask_bit | 127);
+    for (int i = 7; i >= 0; --i)
+      frame += char(uint64_t(payload.size()) >> (i * 8));
+  }
+
+  if (!masked) {
+    frame += payload;
+    return frame;
+  }
+
+  static thread_local std::mt19937 gen{std::random_device{}()};
+  uint32_t key = gen();
+  char mask[4] = {char(key >> 24), char(key >> 16), char(key >> 8), char(key)};
+  frame.append(mask, 4);
+  for (size_t i = 0; i < payload.size(); ++i)
+    frame += char(payload[i] ^ mask[i & 3]);
+
+  return frame;
+}
+
+class Ws_frame_reader {
+ public:
+  static constexpr uint64_t max_payload = uint64_t(64) << 20;
+
+  void feed(const char* data, size_t size) { buffer.append(data, size); }
+
+  bool next(Ws_opcode& opcode, std::string& payload) {
+    while (!error) {
+      if (buffer.size() - pos < 2) return need_more();
+
+      const auto* p = reinterpret_cast<const uint8_t*>(buffer.data() + pos);
+      bool fin = p[0] & 0x80;
+      auto op = Ws_opcode(p[0] & 0x0F);
+      bool masked = p[1] & 0x80;
+      uint64_t len = p[1] & 0x7F;
+      size_t header = 2;
+
+      if (len == 126) {
+        if (buffer.size() - pos < 4) return need_more();
+        len = (uint64_t(p[2]) << 8) | p[3];
+        header = 4;
+      } else if (len == 127) {
+        if (buffer.size() - pos < 10) return need_more();
+        len = 0;
+        for (int i = 0; i < 8; ++i) len = (len << 8) | p[2 + i];
+        header = 10;
+      }
+
+      if (len > max_payload ||
+          (op == Ws_opcode::continuation && message.size() + len > max_payload))
+        return fail();
+
+      size_t mask_pos = pos + header;
+      if (masked) header += 4;
+      if (buffer.size() - pos < header + len) return need_more();
+
+      std::string_view data(buffer.data() + pos + header, len);
+      std::string& target = op == Ws_opcode::continuation ? message : payload;
+      size_t offset = target.size();
+      if (op != Ws_opcode::continuation) {
+        target.clear();
+        offset = 0;
+      }
+      target.append(data);
+      if (masked)
+        for (size_t i = 0; i < len; ++i)
+          target[offset + i] ^= buffer[mask_pos + (i & 3)];
+
+      pos += header + len;
+
+      if (op == Ws_opcode::continuation) {
+        if (!fin) continue;
+        opcode = message_opcode;
+        payload.swap(message);
+        message.clear();
+        return true;
+      }
+
+      if (!fin) {
+        message_opcode = op;
+        message.swap(payload);
+        continue;
+      }
+
+      opcode = op;
+      return true;
+    }
+
+    return false;
+  }
+
+  bool failed() const { return error; }
+
+ private:
+  bool fail() {
+    error = true;
+    buffer.clear();
+    message.clear();
+    pos = 0;
+    return false;
+  }
+
+  bool need_more() {
+    buffer.erase(0, pos);
+    pos = 0;
+    return false;
+  }
+
+  std::string buffer;
+  size_t pos = 0;
+  std::string message;
+  Ws_opcode message_opcode = Ws_opcode::text;
+  bool error = false;
+};
+
+class Gzip_inflater {
+ public:
+  Gzip_inflater() { inflateInit2(&stream, 32 + MAX_WBITS); }
+  ~Gzip_inflater() { inflateEnd(&stream); }
+  Gzip_inflater(const Gzip_inflater&) = delete;
+  Gzip_inflater& operator=(const Gzip_inflater&) = delete;
+
+  bool inflate(std::string_view in, std::string& out) {
+    inflateReset(&stream);
+    out.clear();
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream.avail_in = in.size();
+
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+      size_t used = out.size();
+      out.resize(used + std::max<size_t>(in.size() * 4, 4096));
+      stream.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+      stream.avail_out = out.size() - used;
+      ret = ::inflate(&stream, Z_NO_FLUSH);
+      out.resize(out.size() - stream.avail_out);
+      if (ret == Z_BUF_ERROR && stream.avail_in == 0) break;
+    }
+
+    return ret == Z_STREAM_END;
+  }
+
+ private:
+  z_stream stream{};
+};
+
+class Gzip_deflater {
+ public:
+  Gzip_deflater() {
+    deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                 Z_DEFAULT_STRATEGY);
+  }
+  ~Gzip_deflater() { deflateEnd(&stream); }
+  Gzip_deflater(const Gzip_deflater&) = delete;
+  Gzip_deflater& operator=(const Gzip_deflater&) = delete;
+
+  std::string deflate(std::string_view in) {
+    deflateReset(&stream);
+
+    std::string out(deflateBound(&stream, in.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream.avail_in = in.size();
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = out.size();
+    ::deflate(&stream, Z_FINISH);
+    out.resize(out.size() - stream.avail_out);
+
+    return out;
+  }
+
+ private:
+  z_stream stream{};
+};
+
+inline bool send_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        pollfd pfd{fd, POLLOUT, 0};
+        ::poll(&pfd, 1, -1);
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+inline volatile std::sig_atomic_t ws_stop_requested = 0;
+
+class Ws_client {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  Ws_client() = default;
+  ~Ws_client() {
+    if (epoll_fd >= 0) ::close(epoll_fd);
+    if (fd >= 0) ::close(fd);
+  }
+  Ws_client(const Ws_client&) = delete;
+  Ws_client& operator=(const Ws_client&) = delete;
+
+  std::string connect(const std::string& url, bool busy_poll) {
+    if (url.rfind("ws://", 0) != 0) return "only ws:// urls are supported";
+
+    std::string rest = url.substr(5);
+    std::string path = "/";
+    if (auto slash = rest.find('/'); slash != std::string::npos) {
+      path = rest.substr(slash);
+      rest.resize(slash);
+    }
+
+    std::string host = rest;
+    std::string port = "80";
+    if (auto colon = rest.rfind(':'); colon != std::string::npos) {
+      host = rest.substr(0, colon);
+      port = rest.substr(colon + 1);
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res))
+      return "resolve " + host + ": " + gai_strerror(err);
+
+    for (auto* ai = res; ai; ai = ai->ai_next) {
+      fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) continue;
+      if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+      ::close(fd);
+      fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) return "connect " + host + ":" + port + ": " + strerror(errno);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (busy_poll) {
+      int usec = 50;
+      setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+    }
+
+    std::string key(16, '\0');
+    std::random_device rd;
+    for (auto& c : key) c = char(rd());
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + ":" +
+                          port +
+                          "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: " +
+                          base64_encode(key) +
+                          "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    if (!send_all(fd, request)) return "handshake send failed";
+
+    std::string response;
+    char buf[4096];
+    size_t header_end;
+    while ((header_end = response.find("\r\n\r\n")) == std::string::npos) {
+      ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) return "handshake: connection closed";
+      response.append(buf, n);
+    }
+
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0)
+      return "handshake rejected: " + response.substr(0, response.find("\r\n"));
+    if (response.find(ws_accept_key(base64_encode(key))) == std::string::npos)
+      return "handshake: bad Sec-WebSocket-Accept";
+
+    reader.feed(response.data() + header_end + 4,
+                response.size() - header_end - 4);
+
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    epoll_fd = epoll_create1(0);
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+    this->busy_poll = busy_poll;
+    return "";
+  }
+
+  bool failed() const { return reader.failed(); }
+
+  // Binary frames that did not inflate; they are not passed on.
+  size_t get_dropped_frames() const { return dropped_frames; }
+
+  bool send_text(std::string_view text) {
+    return send_all(fd, encode_frame(Ws_opcode::text, text, true));
+  }
+
+  template <class Handler, class Timer>
+  void run(Handler&& on_message, Timer&& on_timer,
+           std::chrono::milliseconds period) {
+    char buf[1 << 16];
+    epoll_event events[1];
+    Ws_opcode opcode;
+    std::string payload;
+    std::string text;
+
+    clock::time_point recv_time = clock::now();
+    clock::time_point next_timer = recv_time + period;
+    if (dispatch(on_message, recv_time, opcode, payload, text)) return;
+
+    while (!ws_stop_requested) {
+      int n = epoll_wait(epoll_fd, events, 1, busy_poll ? 0 : period.count());
+
+      if (clock::time_point now = clock::now(); now >= next_timer) {
+        on_timer(now);
+        next_timer = now + period;
+      }
+
+      if (n < 0 && errno != EINTR) return;
+      if (n <= 0) continue;
+
+      bool readable = false;
+      bool closed = false;
+      while (true) {
+        ssize_t r = ::recv(fd, buf, sizeof(buf), 0);
+        if (r > 0) {
+          if (!readable) recv_time = clock::now();
+          readable = true;
+          reader.feed(buf, r);
+          continue;
+        }
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        closed = true;
+        break;
+      }
+
+      // Frames fed before the peer closed are still delivered.
+      if (dispatch(on_message, recv_time, opcode, payload, text)) return;
+      if (closed) return;
+    }
+  }
+
+ private:
+  template <class Handler>
+  bool dispatch(Handler& on_message, clock::time_point recv_time,
+                Ws_opcode& opcode, std::string& payload, std::string& text) {
+    while (reader.next(opcode, payload)) {
+      switch (opcode) {
+        case Ws_opcode::text:
+          on_message(payload, recv_time);
+          break;
+        case Ws_opcode::binary:
+          if (inflater.inflate(payload, text))
+            on_message(text, recv_time);
+          else
+            ++dropped_frames;
+          break;
+        case Ws_opcode::ping:
+          send_all(fd, encode_frame(Ws_opcode::pong, payload, true));
+          break;
+        case Ws_opcode::close:
+          send_all(fd, encode_frame(Ws_opcode::close, payload, true));
+          return true;
+        default:
+          break;
+      }
+    }
+    return reader.failed();
+  }
+
+  int fd = -1;
+  int epoll_fd = -1;
+  bool busy_poll = false;
+  size_t dropped_frames = 0;
+  Ws_frame_reader reader;
+  Gzip_inflater inflater;
+};